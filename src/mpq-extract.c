@@ -31,10 +31,20 @@
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
+
+/* reflink includes. */
+#ifdef HAVE_LINUX_FS_H
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
 
 /* libmpq includes. */
 #include <mpq.h>
 
+/* mpq-tools includes. */
+#include "mpq-tools.h"
+
 /* define new print functions for error. */
 #define ERROR(...) fprintf(stderr, __VA_ARGS__);
 
@@ -48,6 +58,64 @@
 #define OFFTSTR "li"
 #endif
 
+/* define how much archive data is prefetched ahead of extraction. */
+#define MPQ_PREFETCH_WINDOW	(32 * 1024 * 1024)
+
+/* define the largest gap between two blocks which are merged into one read. */
+#define MPQ_PREFETCH_GAP	(64 * 1024)
+
+/* define how duplicates are linked to the first written copy. */
+#define MPQ_DEDUP_REFLINK	1
+#define MPQ_DEDUP_HARDLINK	2
+
+/* define the size of a single read while comparing duplicates. */
+#define MPQ_DEDUP_BUFFER	(64 * 1024)
+
+/* this structure holds the properties which equal files have in common. */
+struct mpq_extract__key_s {
+	off_t		size_unpacked;	/* unpacked size of file. */
+	off_t		size_packed;	/* packed size of file. */
+	unsigned int	flags;		/* compressed and imploded flags. */
+};
+
+/* this structure holds one already written payload. */
+struct mpq_extract__payload_s {
+	uint64_t	hash;		/* hash of packed data. */
+	struct mpq_extract__key_s key;	/* sizes and flags of payload. */
+	off_t		offset;		/* absolute offset of packed data. */
+	unsigned int	file_number;	/* file number of first written copy. */
+	unsigned int	next;		/* next payload in bucket, plus one. */
+};
+
+/* this structure holds the duplicate detection state of one archive. */
+struct mpq_extract__dedup_s {
+	struct mpq_extract__key_s *keys;	/* sorted keys of all candidate files. */
+	unsigned int	files;		/* number of candidate files. */
+	unsigned int	*bucket;	/* first payload per hash bucket, plus one. */
+	unsigned int	mask;		/* number of hash buckets minus one. */
+	struct mpq_extract__payload_s *payload;	/* list of written payloads. */
+	unsigned int	count;		/* number of written payloads. */
+	unsigned int	mode;		/* reflink only, or hardlink as fallback. */
+	int		fd;		/* file descriptor for reading packed data. */
+};
+
+/* this structure holds one file of the read schedule. */
+struct mpq_extract__read_s {
+	unsigned int	file_number;	/* file number in archive. */
+	off_t		offset;		/* absolute offset of file in archive file. */
+	off_t		size;		/* packed size of file. */
+};
+
+/* this structure holds the merged extents and the prefetch position. */
+struct mpq_extract__prefetch_s {
+	int		fd;		/* file descriptor used for hints only. */
+	off_t		*offset;	/* start offsets of merged extents. */
+	off_t		*size;		/* sizes of merged extents. */
+	unsigned int	count;		/* number of merged extents. */
+	unsigned int	next;		/* next extent which is not fully prefetched. */
+	off_t		done;		/* offset up to which data was prefetched. */
+};
+
 /* this function show the usage. */
 int mpq_extract__usage(char *program_name) {
 
@@ -59,6 +127,8 @@ int mpq_extract__usage(char *program_name) {
 	NOTICE("  -v, --version		shows the version information\n");
 	NOTICE("  -e, --extract		extract files from the given mpq archive\n");
 	NOTICE("  -l, --list		list the contents of the mpq archive\n");
+	NOTICE("  -d, --dedup		reflink duplicate files instead of writing them again\n");
+	NOTICE("  -H, --hardlink		like --dedup, hardlink if reflink is not supported\n");
 	NOTICE("\n");
 	NOTICE("Please report bugs to the appropriate authors, which can be found in the\n");
 	NOTICE("version information. All other things can be send to <%s>\n", PACKAGE_BUGREPORT);
@@ -81,18 +151,6 @@ int mpq_extract__version(char *program_name) {
 	return 0;
 }
 
-/* XXX: this is a hack to make mpq-tools compile until proper
- * listfile support is added. */
-int32_t libmpq__file_name(mpq_archive_s *mpq_archive, uint32_t file_number, char *filename, size_t filename_size) {
-
-	int32_t result = 0;
-
-	if ((result = snprintf(filename, filename_size, "file%06i.xxx", file_number)) < 0) {
-		return LIBMPQ_ERROR_FORMAT;
-	}
-	return result;
-}
-
 /* this function will list the archive content. */
 int mpq_extract__list(char *mpq_filename, unsigned int file_number, unsigned int number, unsigned int files) {
 
@@ -138,7 +196,7 @@ int mpq_extract__list(char *mpq_filename, unsigned int file_number, unsigned int
 		libmpq__file_encrypted(mpq_archive, file_number, &encrypted);
 		libmpq__file_compressed(mpq_archive, file_number, &compressed);
 		libmpq__file_imploded(mpq_archive, file_number, &imploded);
-		libmpq__file_name(mpq_archive, file_number, filename, PATH_MAX);
+		mpq_tools__file_name(mpq_archive, file_number, filename, PATH_MAX);
 
 		/* show the file information. */
 		NOTICE("file number:			%i/%i\n", file_number, total_files);
@@ -171,7 +229,7 @@ int mpq_extract__list(char *mpq_filename, unsigned int file_number, unsigned int
 			libmpq__file_encrypted(mpq_archive, i, &encrypted);
 			libmpq__file_compressed(mpq_archive, i, &compressed);
 			libmpq__file_imploded(mpq_archive, i, &imploded);
-			libmpq__file_name(mpq_archive, i, filename, PATH_MAX);
+			mpq_tools__file_name(mpq_archive, i, filename, PATH_MAX);
 
 			/* show file information. */
 			NOTICE("  %4i   %10" OFFTSTR "   %9" OFFTSTR " %6.0f%%   %3s   %3s   %3s   %s\n",
@@ -211,6 +269,16 @@ int mpq_extract__list(char *mpq_filename, unsigned int file_number, unsigned int
 	return 0;
 }
 
+/* this function creates a new output file, never writing through an existing one. */
+static FILE *mpq_extract__create(char *filename) {
+
+	/* remove old file, it could be a link shared with other files. */
+	unlink(filename);
+
+	/* open file for writing. */
+	return fopen(filename, "wb");
+}
+
 /* this function extract a single file from archive. */
 int mpq_extract__extract_file(mpq_archive_s *mpq_archive, unsigned int file_number, FILE *fp) {
 
@@ -221,7 +289,7 @@ int mpq_extract__extract_file(mpq_archive_s *mpq_archive, unsigned int file_numb
 	off_t out_size    = 0;
 	int result        = 0;
 
-	libmpq__file_name(mpq_archive, file_number, filename, PATH_MAX);
+	mpq_tools__file_name(mpq_archive, file_number, filename, PATH_MAX);
 
 	/* get/show filename to extract. */
 	if (filename == NULL) {
@@ -249,13 +317,435 @@ int mpq_extract__extract_file(mpq_archive_s *mpq_archive, unsigned int file_numb
 	return 0;
 }
 
+/* this function fetches sizes and flags of a file, returns zero if it cannot be deduplicated. */
+static int mpq_extract__key(mpq_archive_s *mpq_archive, unsigned int file_number, struct mpq_extract__key_s *key) {
+
+	/* some common variables. */
+	unsigned int encrypted  = 0;
+	unsigned int compressed = 0;
+	unsigned int imploded   = 0;
+
+	/* fetch information. */
+	key->size_unpacked = 0;
+	key->size_packed   = 0;
+	libmpq__file_size_unpacked(mpq_archive, file_number, &key->size_unpacked);
+	libmpq__file_size_packed(mpq_archive, file_number, &key->size_packed);
+	libmpq__file_encrypted(mpq_archive, file_number, &encrypted);
+	libmpq__file_compressed(mpq_archive, file_number, &compressed);
+	libmpq__file_imploded(mpq_archive, file_number, &imploded);
+	key->flags = (compressed ? 1 : 0) | (imploded ? 2 : 0);
+
+	/* encrypted data depends on the file name, so it differs for equal files. */
+	return !encrypted && key->size_unpacked > 0 && key->size_packed > 0;
+}
+
+/* this function compares two keys. */
+static int mpq_extract__key_compare(const void *a, const void *b) {
+
+	/* some common variables. */
+	const struct mpq_extract__key_s *ka = a;
+	const struct mpq_extract__key_s *kb = b;
+
+	/* sort by unpacked size, packed size and flags. */
+	if (ka->size_unpacked != kb->size_unpacked) {
+		return ka->size_unpacked < kb->size_unpacked ? -1 : 1;
+	}
+	if (ka->size_packed != kb->size_packed) {
+		return ka->size_packed < kb->size_packed ? -1 : 1;
+	}
+	return ka->flags < kb->flags ? -1 : (ka->flags > kb->flags);
+}
+
+/* this function returns a hash of the given buffer, processing eight bytes per step. */
+static uint64_t mpq_extract__hash(const unsigned char *buffer, off_t size) {
+
+	/* some common variables. */
+	uint64_t hash = 0xcbf29ce484222325ULL ^ (uint64_t)size;
+	uint64_t word;
+	off_t i;
+
+	/* hash whole words. */
+	for (i = 0; i + 8 <= size; i += 8) {
+		memcpy(&word, buffer + i, 8);
+		hash  = (hash ^ word) * 0x100000001b3ULL;
+		hash ^= hash >> 29;
+	}
+
+	/* hash remaining bytes. */
+	for (; i < size; i++) {
+		hash = (hash ^ buffer[i]) * 0x100000001b3ULL;
+	}
+
+	/* return the hash. */
+	return hash;
+}
+
+/* this function reads exactly size bytes at the given offset. */
+static int mpq_extract__pread(int fd, unsigned char *buffer, off_t size, off_t offset) {
+
+	/* some common variables. */
+	ssize_t rb;
+
+	/* read until buffer is full. */
+	while (size > 0) {
+		if ((rb = pread(fd, buffer, size, offset)) <= 0) {
+			return LIBMPQ_ERROR_READ;
+		}
+		buffer += rb;
+		offset += rb;
+		size   -= rb;
+	}
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function initializes duplicate detection for the given archive. */
+static int mpq_extract__dedup_open(mpq_archive_s *mpq_archive, char *mpq_filename, unsigned int total_files, unsigned int mode, struct mpq_extract__dedup_s *dedup) {
+
+	/* some common variables. */
+	unsigned int i;
+
+	/* use at least twice as many buckets as files. */
+	for (dedup->mask = 1; dedup->mask < total_files * 2; dedup->mask <<= 1);
+
+	/* allocate keys, buckets and payloads. */
+	dedup->files   = 0;
+	dedup->count   = 0;
+	dedup->mode    = mode;
+	dedup->mask   -= 1;
+	dedup->keys    = malloc((total_files + 1) * sizeof(struct mpq_extract__key_s));
+	dedup->bucket  = calloc(dedup->mask + 1, sizeof(unsigned int));
+	dedup->payload = malloc((total_files + 1) * sizeof(struct mpq_extract__payload_s));
+
+	/* check if allocation was successful. */
+	if (dedup->keys == NULL || dedup->bucket == NULL || dedup->payload == NULL) {
+		free(dedup->keys);
+		free(dedup->bucket);
+		free(dedup->payload);
+		return LIBMPQ_ERROR_MALLOC;
+	}
+
+	/* open archive file for reading packed data, without it nothing is deduplicated. */
+	if ((dedup->fd = open(mpq_filename, O_RDONLY)) < 0) {
+		return 0;
+	}
+
+	/* fetch key of every file which can be deduplicated. */
+	for (i = 0; i < total_files; i++) {
+		if (mpq_extract__key(mpq_archive, i, &dedup->keys[dedup->files])) {
+			dedup->files++;
+		}
+	}
+
+	/* sort keys, only files sharing a key can be duplicates. */
+	qsort(dedup->keys, dedup->files, sizeof(struct mpq_extract__key_s), mpq_extract__key_compare);
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function frees duplicate detection state. */
+static void mpq_extract__dedup_close(struct mpq_extract__dedup_s *dedup) {
+
+	/* close archive file. */
+	if (dedup->fd >= 0) {
+		close(dedup->fd);
+	}
+
+	/* free keys, buckets and payloads. */
+	free(dedup->keys);
+	free(dedup->bucket);
+	free(dedup->payload);
+}
+
+/* this function checks if more than one file has the given key. */
+static int mpq_extract__dedup_candidate(struct mpq_extract__dedup_s *dedup, struct mpq_extract__key_s *key) {
+
+	/* some common variables. */
+	struct mpq_extract__key_s *found;
+
+	/* search key in sorted list. */
+	if ((found = bsearch(key, dedup->keys, dedup->files, sizeof(struct mpq_extract__key_s), mpq_extract__key_compare)) == NULL) {
+		return 0;
+	}
+
+	/* check neighbours for the same key. */
+	return (found > dedup->keys && mpq_extract__key_compare(found - 1, key) == 0) ||
+	       (found < dedup->keys + dedup->files - 1 && mpq_extract__key_compare(found + 1, key) == 0);
+}
+
+/* this function checks if the packed data at the given offset matches the given buffer. */
+static int mpq_extract__dedup_compare(int fd, off_t offset, unsigned char *buffer, off_t size) {
+
+	/* some common variables. */
+	unsigned char data[MPQ_DEDUP_BUFFER];
+	off_t done = 0;
+	off_t length;
+
+	/* compare chunk by chunk. */
+	while (done < size) {
+		length = size - done < MPQ_DEDUP_BUFFER ? size - done : MPQ_DEDUP_BUFFER;
+		if (mpq_extract__pread(fd, data, length, offset + done) < 0 || memcmp(data, buffer + done, length) != 0) {
+			return 0;
+		}
+		done += length;
+	}
+
+	/* packed data is equal. */
+	return 1;
+}
+
+/* this function creates filename as reflink or, if allowed, hardlink of source. */
+static int mpq_extract__dedup_link(char *source, char *filename, unsigned int mode) {
+
+	/* some common variables. */
+	int result = -1;
+#ifdef FICLONE
+	int fd_in;
+	int fd_out;
+#endif
+
+	/* remove old file, link will not overwrite it. */
+	unlink(filename);
+
+#ifdef FICLONE
+	/* try reflink first, it shares data blocks copy-on-write but not the inode. */
+	if ((fd_in = open(source, O_RDONLY)) >= 0) {
+		if ((fd_out = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0666)) >= 0) {
+			result = ioctl(fd_out, FICLONE, fd_in);
+			close(fd_out);
+			if (result < 0) {
+				unlink(filename);
+			}
+		}
+		close(fd_in);
+	}
+#endif
+
+	/* hardlink only if requested, changing one file changes all links. */
+	if (result < 0 && mode == MPQ_DEDUP_HARDLINK) {
+		result = link(source, filename);
+	}
+
+	/* return result of linking. */
+	return result;
+}
+
+/* this function extracts a single file into a new output file. */
+static int mpq_extract__extract_new(mpq_archive_s *mpq_archive, unsigned int file_number, char *filename) {
+
+	/* some common variables. */
+	int result = 0;
+	FILE *fp;
+
+	/* open file for writing. */
+	if ((fp = mpq_extract__create(filename)) == NULL) {
+
+		/* open file failed. */
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* extract file. */
+	result = mpq_extract__extract_file(mpq_archive, file_number, fp);
+
+	/* close file. */
+	if ((fclose(fp)) < 0 && result == 0) {
+
+		/* close file failed. */
+		return LIBMPQ_ERROR_CLOSE;
+	}
+
+	/* return result of extraction. */
+	return result;
+}
+
+/* this function extracts a single file, linking it if equal packed data was already written. */
+static int mpq_extract__extract_dedup(mpq_archive_s *mpq_archive, unsigned int file_number, char *filename, struct mpq_extract__dedup_s *dedup) {
+
+	/* some common variables. */
+	static char source[PATH_MAX];
+	struct mpq_extract__payload_s *payload;
+	struct mpq_extract__key_s key;
+	unsigned char *in_buf;
+	unsigned int i;
+	off_t offset = 0;
+	uint64_t hash;
+	int result   = 0;
+
+	/* check if any other file has the same sizes and flags. */
+	if (!mpq_extract__key(mpq_archive, file_number, &key) || !mpq_extract__dedup_candidate(dedup, &key)) {
+		return mpq_extract__extract_new(mpq_archive, file_number, filename);
+	}
+
+	/* read packed data, without decompressing it. */
+	if (mpq_tools__file_offset(mpq_archive, file_number, &offset) < 0) {
+		return mpq_extract__extract_new(mpq_archive, file_number, filename);
+	}
+	if ((in_buf = malloc(key.size_packed)) == NULL) {
+		return LIBMPQ_ERROR_MALLOC;
+	}
+	if (mpq_extract__pread(dedup->fd, in_buf, key.size_packed, offset) < 0) {
+		free(in_buf);
+		return mpq_extract__extract_new(mpq_archive, file_number, filename);
+	}
+
+	/* loop through written payloads with same hash bucket. */
+	hash = mpq_extract__hash(in_buf, key.size_packed);
+	for (i = dedup->bucket[hash & dedup->mask]; i > 0; i = payload->next) {
+		payload = &dedup->payload[i - 1];
+
+		/* skip payloads with different key or hash. */
+		if (payload->hash != hash || mpq_extract__key_compare(&payload->key, &key) != 0) {
+			continue;
+		}
+
+		/* confirm packed data and link file to the first written copy. */
+		mpq_tools__file_name(mpq_archive, payload->file_number, source, PATH_MAX);
+		if (mpq_extract__dedup_compare(dedup->fd, payload->offset, in_buf, key.size_packed) && mpq_extract__dedup_link(source, filename, dedup->mode) == 0) {
+			NOTICE("linking %s to %s\n", filename, source);
+			free(in_buf);
+			return 0;
+		}
+	}
+
+	/* free input buffer. */
+	free(in_buf);
+
+	/* no duplicate found or linking failed, extract file. */
+	if ((result = mpq_extract__extract_new(mpq_archive, file_number, filename)) < 0) {
+		return result;
+	}
+
+	/* remember payload for following duplicates. */
+	payload              = &dedup->payload[dedup->count++];
+	payload->hash        = hash;
+	payload->key         = key;
+	payload->offset      = offset;
+	payload->file_number = file_number;
+	payload->next        = dedup->bucket[hash & dedup->mask];
+	dedup->bucket[hash & dedup->mask] = dedup->count;
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function compares two scheduled reads by offset. */
+static int mpq_extract__read_compare(const void *a, const void *b) {
+
+	/* some common variables. */
+	const struct mpq_extract__read_s *ra = a;
+	const struct mpq_extract__read_s *rb = b;
+
+	/* sort by offset, keep file number order for equal offsets. */
+	if (ra->offset != rb->offset) {
+		return ra->offset < rb->offset ? -1 : 1;
+	}
+	return ra->file_number < rb->file_number ? -1 : (ra->file_number > rb->file_number);
+}
+
+/* this function plans the read schedule from the block table. */
+static void mpq_extract__plan(mpq_archive_s *mpq_archive, char *mpq_filename, unsigned int total_files, struct mpq_extract__read_s *schedule, struct mpq_extract__prefetch_s *prefetch) {
+
+	/* some common variables. */
+	off_t end = 0;
+	unsigned int i;
+
+	/* fetch offset and packed size of every file. */
+	for (i = 0; i < total_files; i++) {
+		schedule[i].file_number = i;
+		schedule[i].offset      = 0;
+		schedule[i].size        = 0;
+		mpq_tools__file_offset(mpq_archive, i, &schedule[i].offset);
+		libmpq__file_size_packed(mpq_archive, i, &schedule[i].size);
+	}
+
+	/* extract files in on-disk order to avoid seeking back and forth. */
+	qsort(schedule, total_files, sizeof(struct mpq_extract__read_s), mpq_extract__read_compare);
+
+	/* merge adjacent or nearby blocks into large extents. */
+	prefetch->count = 0;
+	for (i = 0; i < total_files; i++) {
+
+		/* skip empty files. */
+		if (schedule[i].size <= 0) {
+			continue;
+		}
+
+		/* check if block extends the last extent. */
+		if (prefetch->count > 0 && schedule[i].offset <= end + MPQ_PREFETCH_GAP) {
+			if (schedule[i].offset + schedule[i].size > end) {
+				end = schedule[i].offset + schedule[i].size;
+				prefetch->size[prefetch->count - 1] = end - prefetch->offset[prefetch->count - 1];
+			}
+			continue;
+		}
+
+		/* start new extent. */
+		end = schedule[i].offset + schedule[i].size;
+		prefetch->offset[prefetch->count] = schedule[i].offset;
+		prefetch->size[prefetch->count]   = schedule[i].size;
+		prefetch->count++;
+	}
+
+	/* nothing is prefetched yet, open archive file for hints only, without it extraction works unhinted. */
+	prefetch->next = 0;
+	prefetch->done = 0;
+	prefetch->fd   = open(mpq_filename, O_RDONLY);
+}
+
+/* this function keeps a bounded window of archive data prefetched ahead of the given position. */
+static void mpq_extract__prefetch(struct mpq_extract__prefetch_s *prefetch, off_t position) {
+
+	/* some common variables. */
+	off_t target = position + MPQ_PREFETCH_WINDOW;
+	off_t start;
+	off_t end;
+
+	/* check if hints are possible. */
+	if (prefetch->fd < 0) {
+		return;
+	}
+
+	/* loop through extents until window is filled. */
+	while (prefetch->next < prefetch->count && prefetch->done < target) {
+
+		/* clip extent to the not yet prefetched part of the window. */
+		start = prefetch->offset[prefetch->next];
+		end   = start + prefetch->size[prefetch->next];
+		if (start < prefetch->done) {
+			start = prefetch->done;
+		}
+		if (end > target) {
+			end = target;
+		}
+
+#ifdef HAVE_POSIX_FADVISE
+		/* tell the kernel to start reading in the background. */
+		if (end > start) {
+			posix_fadvise(prefetch->fd, start, end - start, POSIX_FADV_WILLNEED);
+		}
+#endif
+
+		/* remember position and check if extent is done. */
+		prefetch->done = end;
+		if (end >= prefetch->offset[prefetch->next] + prefetch->size[prefetch->next]) {
+			prefetch->next++;
+		}
+	}
+}
+
 /* this function will extract the archive content. */
-int mpq_extract__extract(char *mpq_filename, unsigned int file_number) {
+int mpq_extract__extract(char *mpq_filename, unsigned int file_number, unsigned int dedup) {
 
 	/* some common variables. */
 	mpq_archive_s *mpq_archive;
 	static char filename[PATH_MAX];
+	struct mpq_extract__read_s *schedule;
+	struct mpq_extract__prefetch_s prefetch;
+	struct mpq_extract__dedup_s table;
 	unsigned int i;
+	unsigned int j;
 	unsigned int total_files = 0;
 	int result               = 0;
 	FILE *fp;
@@ -271,7 +761,7 @@ int mpq_extract__extract(char *mpq_filename, unsigned int file_number) {
 	if (file_number != -1) {
 
 		/* get filename. */
-		libmpq__file_name(mpq_archive, file_number, filename, PATH_MAX);
+		mpq_tools__file_name(mpq_archive, file_number, filename, PATH_MAX);
 
 		if (filename == NULL) {
 
@@ -280,7 +770,7 @@ int mpq_extract__extract(char *mpq_filename, unsigned int file_number) {
 		}
 
 		/* open file for writing. */
-		if ((fp = fopen(filename, "wb")) == NULL) {
+		if ((fp = mpq_extract__create(filename)) == NULL) {
 
 			/* open file failed. */
 			return LIBMPQ_ERROR_OPEN;
@@ -314,50 +804,123 @@ int mpq_extract__extract(char *mpq_filename, unsigned int file_number) {
 		/* fetch number of files. */
 		libmpq__archive_files(mpq_archive, &total_files);
 
-		/* loop through all files. */
-		for (i = 0; i < total_files; i++) {
+		/* allocate read schedule and extents. */
+		schedule        = malloc((total_files + 1) * sizeof(struct mpq_extract__read_s));
+		prefetch.offset = malloc((total_files + 1) * sizeof(off_t));
+		prefetch.size   = malloc((total_files + 1) * sizeof(off_t));
+
+		/* check if allocation was successful. */
+		if (schedule == NULL || prefetch.offset == NULL || prefetch.size == NULL) {
+
+			/* free read schedule and extents. */
+			free(schedule);
+			free(prefetch.offset);
+			free(prefetch.size);
+
+			/* always close file descriptor, file could be opened also if it is no valid mpq archive. */
+			libmpq__archive_close(mpq_archive);
+
+			/* allocation failed. */
+			return LIBMPQ_ERROR_MALLOC;
+		}
+
+		/* check if duplicates should be detected. */
+		if (dedup && (result = mpq_extract__dedup_open(mpq_archive, mpq_filename, total_files, dedup, &table)) < 0) {
+
+			/* free read schedule and extents. */
+			free(schedule);
+			free(prefetch.offset);
+			free(prefetch.size);
+
+			/* always close file descriptor, file could be opened also if it is no valid mpq archive. */
+			libmpq__archive_close(mpq_archive);
+
+			/* allocation failed. */
+			return result;
+		}
+
+		/* plan read schedule from block table. */
+		mpq_extract__plan(mpq_archive, mpq_filename, total_files, schedule, &prefetch);
+
+		/* loop through all files in on-disk order. */
+		for (j = 0; j < total_files; j++) {
+
+			/* keep data ahead of this file prefetched. */
+			i = schedule[j].file_number;
+			mpq_extract__prefetch(&prefetch, schedule[j].offset);
 
 			/* get filename. */
-			libmpq__file_name(mpq_archive, i, filename, PATH_MAX);
+			mpq_tools__file_name(mpq_archive, i, filename, PATH_MAX);
 
 			/* check if file exist. */
 			if (filename == NULL) {
 
 				/* filename was not found. */
-				return LIBMPQ_ERROR_EXIST;
+				result = LIBMPQ_ERROR_EXIST;
+				break;
+			}
+
+			/* check if duplicates should be linked. */
+			if (dedup) {
+
+				/* extract or link file. */
+				if ((result = mpq_extract__extract_dedup(mpq_archive, i, filename, &table)) < 0) {
+					break;
+				}
+				continue;
 			}
 
 			/* open file for writing. */
-			if ((fp = fopen(filename, "wb")) == NULL) {
+			if ((fp = mpq_extract__create(filename)) == NULL) {
 
 				/* open file failed. */
-				return LIBMPQ_ERROR_OPEN;
+				result = LIBMPQ_ERROR_OPEN;
+				break;
 			}
 
 			/* extract file. */
 			if ((result = mpq_extract__extract_file(mpq_archive, i, fp)) < 0) {
 
-				/* close file. */
-				if ((fclose(fp)) < 0) {
-
-					/* close file failed. */
-					return LIBMPQ_ERROR_CLOSE;
-				}
-
-				/* always close file descriptor, file could be opened also if it is no valid mpq archive. */
-				libmpq__archive_close(mpq_archive);
+				/* close file, extraction error is reported. */
+				fclose(fp);
 
 				/* something on extracting file failed. */
-				return result;
+				break;
 			}
 
 			/* close file. */
 			if ((fclose(fp)) < 0) {
 
 				/* close file failed. */
-				return LIBMPQ_ERROR_CLOSE;
+				result = LIBMPQ_ERROR_CLOSE;
+				break;
 			}
 		}
+
+		/* close hint descriptor. */
+		if (prefetch.fd >= 0) {
+			close(prefetch.fd);
+		}
+
+		/* free duplicate detection state. */
+		if (dedup) {
+			mpq_extract__dedup_close(&table);
+		}
+
+		/* free read schedule and extents. */
+		free(schedule);
+		free(prefetch.offset);
+		free(prefetch.size);
+
+		/* check if extraction failed. */
+		if (result < 0) {
+
+			/* always close file descriptor, file could be opened also if it is no valid mpq archive. */
+			libmpq__archive_close(mpq_archive);
+
+			/* something on extracting file failed. */
+			return result;
+		}
 	}
 
 	/* always close file descriptor, file could be opened also if it is no valid mpq archive. */
@@ -374,12 +937,14 @@ int main(int argc, char **argv) {
 	int result;
 	int opt;
 	int option_index = 0;
-	static char const short_options[] = "hvelf:";
+	static char const short_options[] = "hveldHf:";
 	static struct option const long_options[] = {
 		{"help",	no_argument,		0,	'h'},
 		{"version",	no_argument,		0,	'v'},
 		{"extract",	no_argument,		0,	'e'},
 		{"list",	no_argument,		0,	'l'},
+		{"dedup",	no_argument,		0,	'd'},
+		{"hardlink",	no_argument,		0,	'H'},
 		{0,		0,			0,	0}
 	};
 	optind = 0;
@@ -389,6 +954,7 @@ int main(int argc, char **argv) {
 	char *program_name;
 	char mpq_filename[PATH_MAX];
 	unsigned int action = 0;
+	unsigned int dedup  = 0;
 	unsigned int count;
 
 	/* get program name. */
@@ -441,6 +1007,14 @@ int main(int argc, char **argv) {
 			case 'e':
 				action = 2;
 				continue;
+			case 'd':
+				if (!dedup) {
+					dedup = MPQ_DEDUP_REFLINK;
+				}
+				continue;
+			case 'H':
+				dedup = MPQ_DEDUP_HARDLINK;
+				continue;
 			default:
 
 				/* show some info on how to get help. :) */
@@ -476,6 +1050,16 @@ int main(int argc, char **argv) {
 	/* count number of files to process in archive. */
 	count = argc - optind;
 
+	/* check if deduplication can be used. */
+	if (dedup && (action != 2 || count > 0)) {
+		ERROR("%s: --dedup and --hardlink work only when extracting all files.\n", program_name);
+
+		ERROR("Try `%s --help' for more information.\n", program_name);
+
+		/* exit with error. */
+		exit(1);
+	}
+
 	/* process file names. */
 	do {
 		unsigned int file_number = 0;
@@ -500,7 +1084,7 @@ int main(int argc, char **argv) {
 		/* check if we should extract archive content. */
 		if (action == 2) {
 			/* extract archive content. */
-			result = mpq_extract__extract(mpq_filename, file_number - 1);
+			result = mpq_extract__extract(mpq_filename, file_number - 1, dedup);
 		}
 
 		/* check if archive was correctly opened. */
@@ -22,15 +22,24 @@
 #include "config.h"
 
 /* generic includes. */
+#include <dirent.h>
+#include <fcntl.h>
 #include <getopt.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 /* libmpq includes. */
 #include <mpq.h>
 
+/* mpq-tools includes. */
+#include "mpq-manifest.h"
+#include "mpq-manifest-write.h"
+
 /* define new print functions for error. */
 #define ERROR(...) fprintf(stderr, __VA_ARGS__);
 
@@ -44,6 +53,34 @@
 #define OFFTSTR "li"
 #endif
 
+/* define the mpq header signature and the alignment it is searched on. */
+#define MPQ_SCAN_SIGNATURE	"MPQ\x1A"
+#define MPQ_SCAN_ALIGN		512
+
+/* define the size of a single read while scanning, multiple of alignment. */
+#define MPQ_SCAN_BUFFER		(4 * 1024 * 1024)
+
+/* define the maximum number of parallel scan threads. */
+#define MPQ_SCAN_THREADS	64
+
+/* define the maximum number of files queued for the scan threads. */
+#define MPQ_SCAN_QUEUE		4096
+
+/* this structure holds the work shared by the scan threads. */
+struct mpq_info__scan_s {
+	char		*program_name;	/* program name for error messages. */
+	char		**dir;		/* stack of directories not yet listed. */
+	unsigned int	dirs;		/* number of directories on stack. */
+	unsigned int	dir_size;	/* number of allocated stack entries. */
+	char		*file[MPQ_SCAN_QUEUE];	/* ring of files not yet scanned. */
+	unsigned int	files;		/* number of files in ring. */
+	unsigned int	head;		/* first file in ring. */
+	unsigned int	busy;		/* number of threads working on an item. */
+	unsigned int	errors;		/* number of files and directories skipped. */
+	pthread_mutex_t	lock;		/* protects queues and standard output. */
+	pthread_cond_t	wait;		/* signaled when work is queued or done. */
+};
+
 /* this function show the usage. */
 int mpq_info__usage(char *program_name) {
 
@@ -53,6 +90,9 @@ int mpq_info__usage(char *program_name) {
 	NOTICE("\n");
 	NOTICE("  -h, --help		shows this help screen\n");
 	NOTICE("  -v, --version		shows the version information\n");
+	NOTICE("  -s, --scan		scan the given directories recursively for archives\n");
+	NOTICE("  -m, --manifest=FILE	write a binary manifest of the given archives\n");
+	NOTICE("  -q, --query=FILE	show archives holding the given files from a manifest\n");
 	NOTICE("\n");
 	NOTICE("Please report bugs to the appropriate authors, which can be found in the\n");
 	NOTICE("version information. All other things can be send to <%s>\n", PACKAGE_BUGREPORT);
@@ -126,17 +166,403 @@ int mpq_info__archive_info(char *program_name, char *mpq_filename, unsigned int
 	return 0;
 }
 
+/* this function pushes a directory on the stack, lock must be held. */
+static int mpq_info__scan_push(struct mpq_info__scan_s *scan, char *path) {
+
+	/* some common variables. */
+	char **list;
+
+	/* grow stack if needed. */
+	if (scan->dirs == scan->dir_size) {
+		scan->dir_size = scan->dir_size ? scan->dir_size * 2 : 64;
+		if ((list = realloc(scan->dir, scan->dir_size * sizeof(char *))) == NULL) {
+			return LIBMPQ_ERROR_MALLOC;
+		}
+		scan->dir = list;
+	}
+
+	/* store directory and wake up an idle thread. */
+	scan->dir[scan->dirs++] = path;
+	pthread_cond_signal(&scan->wait);
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function emits an index line for the archive at the given offset, if any. */
+static int mpq_info__scan_archive(struct mpq_info__scan_s *scan, char *mpq_filename, off_t offset) {
+
+	/* some common variables. */
+	off_t size_packed    = 0;
+	off_t size_unpacked  = 0;
+	unsigned int version = 0;
+	unsigned int files   = 0;
+	mpq_archive_s *mpq_archive;
+
+	/* open the mpq-archive, signature could be random data. */
+	if (libmpq__archive_open(&mpq_archive, mpq_filename, offset) < 0) {
+		return 0;
+	}
+
+	/* fetch some required information. */
+	libmpq__archive_version(mpq_archive, &version);
+	libmpq__archive_files(mpq_archive, &files);
+	libmpq__archive_size_packed(mpq_archive, &size_packed);
+	libmpq__archive_size_unpacked(mpq_archive, &size_unpacked);
+	libmpq__archive_close(mpq_archive);
+
+	/* show index line, one per archive. */
+	pthread_mutex_lock(&scan->lock);
+	NOTICE("%s\t%" OFFTSTR "\t%i\t%i\t%" OFFTSTR "\t%" OFFTSTR "\n", mpq_filename, offset, version, files, size_packed, size_unpacked);
+	pthread_mutex_unlock(&scan->lock);
+
+	/* if no error was found, return one found archive. */
+	return 1;
+}
+
+/* this function searches every header aligned offset of a file for archives. */
+static int mpq_info__scan_file(struct mpq_info__scan_s *scan, char *mpq_filename, unsigned char *buffer) {
+
+	/* some common variables. */
+	int fd;
+	ssize_t rb;
+	ssize_t i;
+	off_t offset = 0;
+
+	/* open file for reading. */
+	if ((fd = open(mpq_filename, O_RDONLY)) < 0) {
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+#ifdef HAVE_POSIX_FADVISE
+	/* whole file is read once from start to end. */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+	/* read file in large chunks, aligned to header boundary. */
+	while ((rb = pread(fd, buffer, MPQ_SCAN_BUFFER, offset)) > 0) {
+
+		/* check signature at every aligned position. */
+		for (i = 0; i + 4 <= rb; i += MPQ_SCAN_ALIGN) {
+			if (memcmp(buffer + i, MPQ_SCAN_SIGNATURE, 4) == 0) {
+				mpq_info__scan_archive(scan, mpq_filename, offset + i);
+			}
+		}
+
+#ifdef HAVE_POSIX_FADVISE
+		/* chunk is checked, drop it from page cache. */
+		posix_fadvise(fd, offset, rb, POSIX_FADV_DONTNEED);
+#endif
+
+		/* continue with next chunk. */
+		offset += rb;
+
+		/* short read, so realign to next header boundary. */
+		if (offset % MPQ_SCAN_ALIGN) {
+			offset += MPQ_SCAN_ALIGN - offset % MPQ_SCAN_ALIGN;
+		}
+	}
+
+	/* close file. */
+	if (close(fd) < 0) {
+		return LIBMPQ_ERROR_CLOSE;
+	}
+
+	/* check if read failed. */
+	if (rb < 0) {
+		return LIBMPQ_ERROR_READ;
+	}
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function lists a directory, queueing subdirectories and files. */
+static int mpq_info__scan_directory(struct mpq_info__scan_s *scan, char *directory, unsigned char *buffer) {
+
+	/* some common variables. */
+	struct dirent *entry;
+	struct stat sb;
+	char *path;
+	DIR *dir;
+	int type;
+
+	/* open directory. */
+	if ((dir = opendir(directory)) == NULL) {
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* loop through all entries. */
+	while ((entry = readdir(dir)) != NULL) {
+
+		/* skip current and parent directory. */
+		if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+			continue;
+		}
+
+		/* build path of entry. */
+		if ((path = malloc(strlen(directory) + strlen(entry->d_name) + 2)) == NULL) {
+			closedir(dir);
+			return LIBMPQ_ERROR_MALLOC;
+		}
+		sprintf(path, "%s/%s", directory, entry->d_name);
+
+		/* get type, do not follow symbolic links. */
+		type = entry->d_type;
+		if (type == DT_UNKNOWN && lstat(path, &sb) == 0) {
+			type = S_ISDIR(sb.st_mode) ? DT_DIR : (S_ISREG(sb.st_mode) ? DT_REG : DT_UNKNOWN);
+		}
+
+		/* queue subdirectory for any thread. */
+		if (type == DT_DIR) {
+			pthread_mutex_lock(&scan->lock);
+			if (mpq_info__scan_push(scan, path) < 0) {
+				ERROR("%s: '%s' could not be queued, skipping it\n", scan->program_name, path);
+				scan->errors++;
+				free(path);
+			}
+			pthread_mutex_unlock(&scan->lock);
+			continue;
+		}
+
+		/* skip everything which is not a regular file. */
+		if (type != DT_REG) {
+			free(path);
+			continue;
+		}
+
+		/* queue file if ring has space. */
+		pthread_mutex_lock(&scan->lock);
+		if (scan->files < MPQ_SCAN_QUEUE) {
+			scan->file[(scan->head + scan->files++) % MPQ_SCAN_QUEUE] = path;
+			pthread_cond_signal(&scan->wait);
+			pthread_mutex_unlock(&scan->lock);
+			continue;
+		}
+		pthread_mutex_unlock(&scan->lock);
+
+		/* ring is full, so scan file in this thread. */
+		if (mpq_info__scan_file(scan, path, buffer) < 0) {
+			ERROR("%s: '%s' could not be read\n", scan->program_name, path);
+			pthread_mutex_lock(&scan->lock);
+			scan->errors++;
+			pthread_mutex_unlock(&scan->lock);
+		}
+		free(path);
+	}
+
+	/* close directory. */
+	if (closedir(dir) < 0) {
+		return LIBMPQ_ERROR_CLOSE;
+	}
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function is the scan thread, working until all queues are empty and no thread is busy. */
+static void *mpq_info__scan_thread(void *data) {
+
+	/* some common variables. */
+	struct mpq_info__scan_s *scan = data;
+	unsigned char *buffer;
+	char *path;
+	int result;
+
+	/* allocate read buffer. */
+	if ((buffer = malloc(MPQ_SCAN_BUFFER)) == NULL) {
+		return NULL;
+	}
+
+	/* loop until all work is done. */
+	pthread_mutex_lock(&scan->lock);
+	while (1) {
+
+		/* prefer files, so the ring drains while directories are listed. */
+		if (scan->files > 0) {
+			path = scan->file[scan->head];
+			scan->head = (scan->head + 1) % MPQ_SCAN_QUEUE;
+			scan->files--;
+			scan->busy++;
+			pthread_mutex_unlock(&scan->lock);
+
+			/* scan file. */
+			if ((result = mpq_info__scan_file(scan, path, buffer)) < 0) {
+				ERROR("%s: '%s' could not be read\n", scan->program_name, path);
+			}
+		} else if (scan->dirs > 0) {
+			path = scan->dir[--scan->dirs];
+			scan->busy++;
+			pthread_mutex_unlock(&scan->lock);
+
+			/* list directory. */
+			if ((result = mpq_info__scan_directory(scan, path, buffer)) < 0) {
+				ERROR("%s: '%s' could not be scanned\n", scan->program_name, path);
+			}
+		} else if (scan->busy > 0) {
+
+			/* other threads may still queue work. */
+			pthread_cond_wait(&scan->wait, &scan->lock);
+			continue;
+		} else {
+
+			/* nothing queued and nobody busy, wake up all waiting threads. */
+			pthread_cond_broadcast(&scan->wait);
+			break;
+		}
+
+		/* item done, count failure and check if this was the last one. */
+		free(path);
+		pthread_mutex_lock(&scan->lock);
+		if (result < 0) {
+			scan->errors++;
+		}
+		if (--scan->busy == 0 && scan->files == 0 && scan->dirs == 0) {
+			pthread_cond_broadcast(&scan->wait);
+		}
+	}
+	pthread_mutex_unlock(&scan->lock);
+
+	/* free read buffer. */
+	free(buffer);
+
+	/* thread finished. */
+	return NULL;
+}
+
+/* this function scans a directory tree and shows an index of all archives. */
+int mpq_info__scan(char *program_name, char *directory) {
+
+	/* some common variables. */
+	struct mpq_info__scan_s scan;
+	pthread_t threads[MPQ_SCAN_THREADS];
+	char *path;
+	unsigned int errors;
+	long count;
+	long i;
+
+	/* initialize queues with the given directory. */
+	memset(&scan, 0, sizeof(scan));
+	scan.program_name = program_name;
+	pthread_mutex_init(&scan.lock, NULL);
+	pthread_cond_init(&scan.wait, NULL);
+	if ((path = strdup(directory)) == NULL || mpq_info__scan_push(&scan, path) < 0) {
+		ERROR("%s: '%s' could not be queued, skipping it\n", program_name, directory);
+		free(path);
+		pthread_cond_destroy(&scan.wait);
+		pthread_mutex_destroy(&scan.lock);
+		return LIBMPQ_ERROR_MALLOC;
+	}
+
+	/* use one thread per online processor. */
+	if ((count = sysconf(_SC_NPROCESSORS_ONLN)) < 1) {
+		count = 1;
+	}
+	if (count > MPQ_SCAN_THREADS) {
+		count = MPQ_SCAN_THREADS;
+	}
+
+	/* start scan threads, they walk and scan at the same time. */
+	for (i = 0; i < count; i++) {
+		if (pthread_create(&threads[i], NULL, mpq_info__scan_thread, &scan) != 0) {
+			count = i;
+			break;
+		}
+	}
+
+	/* no thread could be started, so scan in this one. */
+	if (count == 0) {
+		mpq_info__scan_thread(&scan);
+	}
+
+	/* wait for scan threads. */
+	for (i = 0; i < count; i++) {
+		pthread_join(threads[i], NULL);
+	}
+
+	/* free queues, they are only left filled if no thread could allocate its buffer. */
+	while (scan.dirs > 0) {
+		ERROR("%s: '%s' could not be scanned\n", program_name, scan.dir[scan.dirs - 1]);
+		free(scan.dir[--scan.dirs]);
+		scan.errors++;
+	}
+	while (scan.files > 0) {
+		ERROR("%s: '%s' could not be read\n", program_name, scan.file[scan.head]);
+		free(scan.file[scan.head]);
+		scan.head = (scan.head + 1) % MPQ_SCAN_QUEUE;
+		scan.files--;
+		scan.errors++;
+	}
+	errors = scan.errors;
+	free(scan.dir);
+	pthread_cond_destroy(&scan.wait);
+	pthread_mutex_destroy(&scan.lock);
+
+	/* check if anything was skipped. */
+	if (errors > 0) {
+		return LIBMPQ_ERROR_READ;
+	}
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function shows every manifest entry holding the given file name. */
+int mpq_info__query(mpq_manifest_s *manifest, char *filename) {
+
+	/* some common variables. */
+	struct mpq_manifest__archive_s *archive;
+	struct mpq_manifest__entry_s *entry;
+	uint32_t next = 0;
+	uint32_t found = 0;
+
+	/* loop through all archives holding the file. */
+	while (mpq_manifest__lookup(manifest, filename, &next, &entry) == 0) {
+
+		/* skip entries of unknown archives. */
+		if (entry->archive >= manifest->header->archives) {
+			continue;
+		}
+		archive = &manifest->archive[entry->archive];
+
+		/* show file information. */
+		NOTICE("%s\t%u\t%llu\t%llu\t%llu\t%s\t%s\t%s\t%s\n",
+			manifest->string + archive->name,
+			(uint32_t)(entry - manifest->entry) - archive->first + 1,
+			(unsigned long long)entry->offset,
+			(unsigned long long)entry->size_packed,
+			(unsigned long long)entry->size_unpacked,
+			(entry->flags & MPQ_MANIFEST_COMPRESSED) ? "yes" : "no",
+			(entry->flags & MPQ_MANIFEST_IMPLODED) ? "yes" : "no",
+			(entry->flags & MPQ_MANIFEST_ENCRYPTED) ? "yes" : "no",
+			filename
+		);
+		found++;
+	}
+
+	/* check if file was found in any archive. */
+	if (found == 0) {
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
 /* the main function starts here. */
 int main(int argc, char **argv) {
 
 	/* common variables for the command line. */
 	int opt;
 	int option_index = 0;
-	static char const short_options[] = "hv";
+	static char const short_options[] = "hvsm:q:";
 	static struct option const long_options[] = {
-		{"help",	no_argument,	0,	'h'},
-		{"version",	no_argument,	0,	'v'},
-		{0,		0,		0,	0}
+		{"help",	no_argument,		0,	'h'},
+		{"version",	no_argument,		0,	'v'},
+		{"scan",	no_argument,		0,	's'},
+		{"manifest",	required_argument,	0,	'm'},
+		{"query",	required_argument,	0,	'q'},
+		{0,		0,			0,	0}
 	};
 	optind = 0;
 	opterr = 0;
@@ -144,6 +570,11 @@ int main(int argc, char **argv) {
 	/* some common variables. */
 	char *program_name;
 	char mpq_filename[PATH_MAX];
+	char manifest_filename[PATH_MAX];
+	mpq_manifest_s *manifest;
+	unsigned int failed;
+	int result;
+	unsigned int action = 0;
 	unsigned int count;
 	unsigned int number;
 
@@ -180,6 +611,19 @@ int main(int argc, char **argv) {
 			case 'v':
 				mpq_info__version(program_name);
 				exit(0);
+			case 's':
+				action = 1;
+				continue;
+			case 'm':
+				action = 2;
+				strncpy(manifest_filename, optarg, PATH_MAX - 1);
+				manifest_filename[PATH_MAX - 1] = '\0';
+				continue;
+			case 'q':
+				action = 3;
+				strncpy(manifest_filename, optarg, PATH_MAX - 1);
+				manifest_filename[PATH_MAX - 1] = '\0';
+				continue;
 			default:
 
 				/* show some info on how to get help. :) */
@@ -191,6 +635,83 @@ int main(int argc, char **argv) {
 		}
 	}
 
+	/* check if archive or directory was given. */
+	if (optind >= argc) {
+		ERROR("%s: no archive given.\n", program_name);
+
+		ERROR("Try `%s --help' for more information.\n", program_name);
+
+		/* exit with error. */
+		exit(1);
+	}
+
+	/* check if we should scan directories. */
+	if (action == 1) {
+
+		/* scan every given directory, continue after failures. */
+		result = 0;
+		do {
+			if (mpq_info__scan(program_name, argv[optind]) < 0) {
+				result = 1;
+			}
+		} while (++optind < argc);
+
+		/* exit with error if anything was skipped. */
+		exit(result);
+	}
+
+	/* check if we should write a manifest. */
+	if (action == 2) {
+
+		/* write manifest of all given archives. */
+		if ((result = mpq_manifest__write(manifest_filename, argv + optind, argc - optind, &failed)) < 0) {
+
+			/* check if an archive or the manifest failed. */
+			if (failed < (unsigned int)(argc - optind)) {
+				ERROR("%s: '%s' could not be read as mpq archive\n", program_name, argv[optind + failed]);
+			} else {
+				ERROR("%s: '%s' could not be written\n", program_name, manifest_filename);
+			}
+
+			/* exit with error. */
+			exit(1);
+		}
+
+		/* execution was successful. */
+		exit(0);
+	}
+
+	/* check if we should query a manifest. */
+	if (action == 3) {
+
+		/* open manifest. */
+		if (mpq_manifest__open(&manifest, manifest_filename) < 0) {
+
+			/* open manifest failed. */
+			ERROR("%s: '%s' is no valid manifest\n", program_name, manifest_filename);
+
+			/* exit with error. */
+			exit(1);
+		}
+
+		/* show every given file name. */
+		result = 0;
+		do {
+			if (mpq_info__query(manifest, argv[optind]) < 0) {
+
+				/* file was not found in manifest. */
+				ERROR("%s: '%s' no such file in manifest '%s'\n", program_name, argv[optind], manifest_filename);
+				result = 1;
+			}
+		} while (++optind < argc);
+
+		/* close manifest. */
+		mpq_manifest__close(manifest);
+
+		/* exit with error if any file was missing. */
+		exit(result);
+	}
+
 	/* fill option structure with long option arguments */
 	count = argc - optind;
 	number = 1;
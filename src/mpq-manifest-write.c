@@ -0,0 +1,451 @@
+/*
+ *  mpq-manifest-write.c -- functions for writing archive manifests.
+ *
+ *  Copyright (c) 2003-2008 Maik Broemme <mbroemme@plusserver.de>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* mpq-tools configuration includes. */
+#include "config.h"
+
+/* generic includes. */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/* libmpq includes. */
+#include <mpq.h>
+
+/* mpq-tools includes. */
+#include "mpq-manifest.h"
+#include "mpq-manifest-write.h"
+#include "mpq-tools.h"
+
+/* this structure holds the string table while writing. */
+struct mpq_manifest__string_s {
+	char		*data;		/* zero terminated strings. */
+	uint32_t	size;		/* used size of string table. */
+	uint32_t	allocated;	/* allocated size of string table. */
+};
+
+/* this structure holds the name table while writing. */
+struct mpq_manifest__list_s {
+	struct mpq_manifest__name_s	*data;	/* file names. */
+	uint32_t	size;		/* used entries of name table. */
+	uint32_t	allocated;	/* allocated entries of name table. */
+};
+
+/* this function compares two names by hash and entry, for qsort(). */
+static int mpq_manifest__name_compare(const void *a, const void *b) {
+
+	/* some common variables. */
+	const struct mpq_manifest__name_s *name_a = a;
+	const struct mpq_manifest__name_s *name_b = b;
+
+	/* sort by hash first, lookups depend on it. */
+	if (name_a->hash != name_b->hash) {
+		return name_a->hash < name_b->hash ? -1 : 1;
+	}
+
+	/* sort equal hashes by entry, so duplicates are adjacent. */
+	if (name_a->entry != name_b->entry) {
+		return name_a->entry < name_b->entry ? -1 : 1;
+	}
+
+	/* names are equal. */
+	return 0;
+}
+
+/* this function appends a string to the string table and returns its offset. */
+static int mpq_manifest__string_add(struct mpq_manifest__string_s *string, const char *value, uint32_t *offset) {
+
+	/* some common variables. */
+	size_t length = strlen(value) + 1;
+	char *data;
+
+	/* grow string table if needed. */
+	while (string->size + length > string->allocated) {
+		string->allocated = string->allocated ? string->allocated * 2 : 65536;
+		if ((data = realloc(string->data, string->allocated)) == NULL) {
+			return LIBMPQ_ERROR_MALLOC;
+		}
+		string->data = data;
+	}
+
+	/* copy string. */
+	memcpy(string->data + string->size, value, length);
+	*offset       = string->size;
+	string->size += length;
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function writes zero bytes until the given section offset is reached. */
+static int mpq_manifest__pad(FILE *fp, uint64_t offset) {
+
+	/* write zero bytes. */
+	while ((uint64_t)ftello(fp) < offset) {
+		if (fputc(0, fp) == EOF) {
+			return LIBMPQ_ERROR_WRITE;
+		}
+	}
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function flushes the directory entry of a file to disk. */
+static int mpq_manifest__sync_directory(const char *filename) {
+
+	/* some common variables. */
+	static char directory[PATH_MAX];
+	int result = 0;
+	int fd;
+
+	/* dirname() may modify its argument, so use a copy. */
+	if (snprintf(directory, PATH_MAX, "%s", filename) >= PATH_MAX) {
+		return LIBMPQ_ERROR_FORMAT;
+	}
+
+	/* open and flush directory. */
+	if ((fd = open(dirname(directory), O_RDONLY)) < 0) {
+		return LIBMPQ_ERROR_OPEN;
+	}
+	if (fsync(fd) < 0) {
+		result = LIBMPQ_ERROR_WRITE;
+	}
+	if (close(fd) < 0 && result == 0) {
+		result = LIBMPQ_ERROR_CLOSE;
+	}
+
+	/* return result of flushing. */
+	return result;
+}
+
+/* this function adds all names of the archive (listfile) to the name table. */
+static int mpq_manifest__add_names(mpq_archive_s *mpq_archive, uint32_t first, uint32_t files, struct mpq_manifest__list_s *list, struct mpq_manifest__string_s *string) {
+
+	/* some common variables. */
+	struct mpq_manifest__name_s *data;
+	off_t size_unpacked = 0;
+	off_t transferred   = 0;
+	uint32_t file_number;
+	char *listfile;
+	char *filename;
+	char *next;
+	int result;
+
+	/* archives without (listfile) have no names, which is no error. */
+	if (libmpq__file_number(mpq_archive, "(listfile)", &file_number) < 0 ||
+	    libmpq__file_size_unpacked(mpq_archive, file_number, &size_unpacked) < 0 ||
+	    size_unpacked <= 0) {
+		return 0;
+	}
+
+	/* read (listfile), zero terminated so it can be split in place. */
+	if ((listfile = calloc(size_unpacked + 1, 1)) == NULL) {
+		return LIBMPQ_ERROR_MALLOC;
+	}
+	if ((result = libmpq__file_read(mpq_archive, file_number, (uint8_t *)listfile, size_unpacked, &transferred)) < 0) {
+		free(listfile);
+		return result;
+	}
+
+	/* loop through all names, separated by line ends or semicolons. */
+	for (filename = listfile; *filename != '\0'; filename = next) {
+
+		/* cut name at separator. */
+		next = filename + strcspn(filename, ";\r\n");
+		if (*next != '\0') {
+			*next++ = '\0';
+		}
+
+		/* skip empty lines and names which are not in the archive. */
+		if (*filename == '\0' ||
+		    libmpq__file_number(mpq_archive, filename, &file_number) < 0 ||
+		    file_number >= files) {
+			continue;
+		}
+
+		/* grow name table if needed. */
+		if (list->size == list->allocated) {
+			list->allocated = list->allocated ? list->allocated * 2 : 4096;
+			if ((data = realloc(list->data, list->allocated * sizeof(struct mpq_manifest__name_s))) == NULL) {
+				free(listfile);
+				return LIBMPQ_ERROR_MALLOC;
+			}
+			list->data = data;
+		}
+
+		/* add name. */
+		list->data[list->size].hash  = mpq_manifest__hash(filename);
+		list->data[list->size].entry = first + file_number;
+		if ((result = mpq_manifest__string_add(string, filename, &list->data[list->size].name)) < 0) {
+			free(listfile);
+			return result;
+		}
+		list->size++;
+	}
+
+	/* free (listfile). */
+	free(listfile);
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function adds all files and names of an archive to the entry and name list. */
+static int mpq_manifest__add_archive(const char *mpq_filename, uint32_t number, struct mpq_manifest__archive_s *archive, struct mpq_manifest__entry_s **entry, uint32_t *entries, struct mpq_manifest__list_s *list, struct mpq_manifest__string_s *string) {
+
+	/* some common variables. */
+	struct mpq_manifest__entry_s *table;
+	mpq_archive_s *mpq_archive;
+	off_t archive_offset = 0;
+	off_t offset;
+	off_t size_packed;
+	off_t size_unpacked;
+	unsigned int version = 0;
+	unsigned int files   = 0;
+	unsigned int encrypted;
+	unsigned int compressed;
+	unsigned int imploded;
+	unsigned int i;
+	int result;
+
+	/* open the mpq-archive. */
+	if ((result = libmpq__archive_open(&mpq_archive, mpq_filename, -1)) < 0) {
+		return result;
+	}
+
+	/* fetch archive information. */
+	libmpq__archive_offset(mpq_archive, &archive_offset);
+	libmpq__archive_version(mpq_archive, &version);
+	libmpq__archive_files(mpq_archive, &files);
+
+	/* fill archive. */
+	archive->offset   = archive_offset;
+	archive->version  = version;
+	archive->files    = files;
+	archive->first    = *entries;
+	if ((result = mpq_manifest__string_add(string, mpq_filename, &archive->name)) < 0) {
+		libmpq__archive_close(mpq_archive);
+		return result;
+	}
+
+	/* grow entry list. */
+	if ((table = realloc(*entry, (*entries + files + 1) * sizeof(struct mpq_manifest__entry_s))) == NULL) {
+		libmpq__archive_close(mpq_archive);
+		return LIBMPQ_ERROR_MALLOC;
+	}
+	*entry = table;
+
+	/* loop through all files. */
+	for (i = 0; i < files; i++) {
+
+		/* cleanup variables. */
+		offset        = 0;
+		size_packed   = 0;
+		size_unpacked = 0;
+		encrypted     = 0;
+		compressed    = 0;
+		imploded      = 0;
+
+		/* fetch file information. */
+		mpq_tools__file_offset(mpq_archive, i, &offset);
+		libmpq__file_size_packed(mpq_archive, i, &size_packed);
+		libmpq__file_size_unpacked(mpq_archive, i, &size_unpacked);
+		libmpq__file_encrypted(mpq_archive, i, &encrypted);
+		libmpq__file_compressed(mpq_archive, i, &compressed);
+		libmpq__file_imploded(mpq_archive, i, &imploded);
+
+		/* fill entry, its position gives archive and file number. */
+		table[*entries].offset        = offset;
+		table[*entries].size_packed   = size_packed;
+		table[*entries].size_unpacked = size_unpacked;
+		table[*entries].flags         = (compressed ? MPQ_MANIFEST_COMPRESSED : 0) |
+					        (imploded ? MPQ_MANIFEST_IMPLODED : 0) |
+					        (encrypted ? MPQ_MANIFEST_ENCRYPTED : 0);
+		table[*entries].archive       = number;
+		(*entries)++;
+	}
+
+	/* add names of all listed files. */
+	if ((result = mpq_manifest__add_names(mpq_archive, archive->first, files, list, string)) < 0) {
+		libmpq__archive_close(mpq_archive);
+		return result;
+	}
+
+	/* always close file descriptor, file could be opened also if it is no valid mpq archive. */
+	libmpq__archive_close(mpq_archive);
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function writes a manifest of the given archives, failed is set to the archive which could not be read. */
+int mpq_manifest__write(const char *manifest_filename, char **mpq_filename, unsigned int count, unsigned int *failed) {
+
+	/* some common variables. */
+	struct mpq_manifest__header_s header;
+	struct mpq_manifest__archive_s *archive;
+	struct mpq_manifest__entry_s *entry = NULL;
+	struct mpq_manifest__list_s list;
+	struct mpq_manifest__string_s string;
+	static char temp_filename[PATH_MAX];
+	uint32_t *bucket     = NULL;
+	uint32_t entries     = 0;
+	uint32_t names       = 0;
+	uint32_t buckets;
+	uint32_t bits;
+	uint32_t i;
+	uint32_t j;
+	int result           = 0;
+	mode_t mask;
+	FILE *fp;
+	int fd;
+
+	/* allocate archive table, no archive failed yet. */
+	*failed = count;
+	memset(&list, 0, sizeof(list));
+	memset(&string, 0, sizeof(string));
+	if ((archive = malloc((count + 1) * sizeof(struct mpq_manifest__archive_s))) == NULL) {
+		return LIBMPQ_ERROR_MALLOC;
+	}
+
+	/* collect files of all archives. */
+	for (i = 0; i < count; i++) {
+		if ((result = mpq_manifest__add_archive(mpq_filename[i], i, &archive[i], &entry, &entries, &list, &string)) < 0) {
+			*failed = i;
+			goto error;
+		}
+	}
+
+	/* sort names by hash and drop names listed twice for the same file. */
+	qsort(list.data, list.size, sizeof(struct mpq_manifest__name_s), mpq_manifest__name_compare);
+	for (i = 0; i < list.size; i++) {
+		if (names == 0 || mpq_manifest__name_compare(&list.data[names - 1], &list.data[i]) != 0) {
+			list.data[names++] = list.data[i];
+		}
+	}
+	list.size = names;
+
+	/* use at least as many buckets as names, indexed by the top hash bits. */
+	for (bits = 1; bits < 31 && ((uint32_t)1 << bits) < names; bits++);
+	buckets = (uint32_t)1 << bits;
+	if ((bucket = malloc((buckets + 1) * sizeof(uint32_t))) == NULL) {
+		result = LIBMPQ_ERROR_MALLOC;
+		goto error;
+	}
+
+	/* store first name of every bucket, last one ends the table. */
+	for (i = 0, j = 0; i <= buckets; i++) {
+		while (j < names && (list.data[j].hash >> (64 - bits)) < i) {
+			j++;
+		}
+		bucket[i] = j;
+	}
+
+	/* fill header. */
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, MPQ_MANIFEST_MAGIC, 4);
+	header.version  = MPQ_MANIFEST_VERSION;
+	header.archives = count;
+	header.entries  = entries;
+	header.names    = names;
+	header.bits     = bits;
+
+	/* compute section offsets. */
+	header.archive_offset = MPQ_MANIFEST_ALIGN(sizeof(header));
+	header.entry_offset   = MPQ_MANIFEST_ALIGN(header.archive_offset + count * sizeof(struct mpq_manifest__archive_s));
+	header.name_offset    = MPQ_MANIFEST_ALIGN(header.entry_offset + (uint64_t)entries * sizeof(struct mpq_manifest__entry_s));
+	header.bucket_offset  = MPQ_MANIFEST_ALIGN(header.name_offset + (uint64_t)names * sizeof(struct mpq_manifest__name_s));
+	header.string_offset  = MPQ_MANIFEST_ALIGN(header.bucket_offset + ((uint64_t)buckets + 1) * sizeof(uint32_t));
+	header.size           = header.string_offset + string.size;
+
+	/* write to unique temporary file next to manifest, readers may have the old manifest mapped. */
+	if (snprintf(temp_filename, PATH_MAX, "%s.XXXXXX", manifest_filename) >= PATH_MAX) {
+		result = LIBMPQ_ERROR_FORMAT;
+		goto error;
+	}
+	if ((fd = mkstemp(temp_filename)) < 0) {
+		result = LIBMPQ_ERROR_OPEN;
+		goto error;
+	}
+	if ((fp = fdopen(fd, "wb")) == NULL) {
+		close(fd);
+		unlink(temp_filename);
+		result = LIBMPQ_ERROR_OPEN;
+		goto error;
+	}
+
+	/* mkstemp() creates private files, use the mode of a normally created file. */
+	mask = umask(0);
+	umask(mask);
+	fchmod(fd, 0666 & ~mask);
+
+	/* write all sections with padding. */
+	if (fwrite(&header, sizeof(header), 1, fp) != 1 ||
+	    mpq_manifest__pad(fp, header.archive_offset) < 0 ||
+	    fwrite(archive, sizeof(struct mpq_manifest__archive_s), count, fp) != count ||
+	    mpq_manifest__pad(fp, header.entry_offset) < 0 ||
+	    fwrite(entry, sizeof(struct mpq_manifest__entry_s), entries, fp) != entries ||
+	    mpq_manifest__pad(fp, header.name_offset) < 0 ||
+	    fwrite(list.data, sizeof(struct mpq_manifest__name_s), names, fp) != names ||
+	    mpq_manifest__pad(fp, header.bucket_offset) < 0 ||
+	    fwrite(bucket, sizeof(uint32_t), buckets + 1, fp) != buckets + 1 ||
+	    mpq_manifest__pad(fp, header.string_offset) < 0 ||
+	    fwrite(string.data, 1, string.size, fp) != string.size ||
+	    fflush(fp) != 0 ||
+	    fsync(fileno(fp)) < 0) {
+		result = LIBMPQ_ERROR_WRITE;
+	}
+
+	/* close manifest. */
+	if (fclose(fp) < 0 && result == 0) {
+		result = LIBMPQ_ERROR_CLOSE;
+	}
+
+	/* replace old manifest at once, mappings of it stay valid. */
+	if (result == 0 && rename(temp_filename, manifest_filename) < 0) {
+		result = LIBMPQ_ERROR_WRITE;
+	}
+	if (result < 0) {
+		unlink(temp_filename);
+	}
+
+	/* make the rename itself durable. */
+	if (result == 0) {
+		result = mpq_manifest__sync_directory(manifest_filename);
+	}
+
+error:
+
+	/* free tables. */
+	free(archive);
+	free(entry);
+	free(list.data);
+	free(bucket);
+	free(string.data);
+
+	/* return result of writing. */
+	return result;
+}
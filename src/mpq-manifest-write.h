@@ -0,0 +1,27 @@
+/*
+ *  mpq-manifest-write.h -- writing binary manifests of archive contents.
+ *
+ *  Copyright (c) 2003-2008 Maik Broemme <mbroemme@plusserver.de>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MPQ_MANIFEST_WRITE_H
+#define _MPQ_MANIFEST_WRITE_H
+
+/* manifest writing functions, needs libmpq. */
+extern int mpq_manifest__write(const char *manifest_filename, char **mpq_filename, unsigned int count, unsigned int *failed);
+
+#endif						/* _MPQ_MANIFEST_WRITE_H */
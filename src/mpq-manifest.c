@@ -0,0 +1,233 @@
+/*
+ *  mpq-manifest.c -- functions for reading archive manifests.
+ *
+ *  Copyright (c) 2003-2008 Maik Broemme <mbroemme@plusserver.de>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* mpq-tools configuration includes. */
+#include "config.h"
+
+/* generic includes. */
+#include <ctype.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/* libmpq includes. */
+#include <mpq.h>
+
+/* mpq-tools includes. */
+#include "mpq-manifest.h"
+
+/* this function returns a file name character as compared by the archive. */
+static int mpq_manifest__char(char c) {
+
+	/* names are case insensitive and both path separators are equal. */
+	return c == '/' ? '\\' : toupper((unsigned char)c);
+}
+
+/* this function returns the 64 bit fnv-1a hash of a file name. */
+uint64_t mpq_manifest__hash(const char *filename) {
+
+	/* some common variables. */
+	uint64_t hash = 0xcbf29ce484222325ULL;
+
+	/* hash every character as compared by the archive. */
+	for (; *filename != '\0'; filename++) {
+		hash ^= (uint64_t)mpq_manifest__char(*filename);
+		hash *= 0x00000100000001b3ULL;
+	}
+
+	/* return the hash. */
+	return hash;
+}
+
+/* this function compares two file names as the archive does. */
+static int mpq_manifest__name_equal(const char *a, const char *b) {
+
+	/* compare until first difference or end of string. */
+	while (*a != '\0' && mpq_manifest__char(*a) == mpq_manifest__char(*b)) {
+		a++;
+		b++;
+	}
+
+	/* equal if both ended. */
+	return mpq_manifest__char(*a) == mpq_manifest__char(*b);
+}
+
+/* this function opens a manifest and maps it into memory. */
+int mpq_manifest__open(mpq_manifest_s **manifest, const char *manifest_filename) {
+
+	/* some common variables. */
+	struct mpq_manifest__header_s *header;
+	struct stat sb;
+	void *data;
+	int fd;
+
+	/* open manifest for reading. */
+	if ((fd = open(manifest_filename, O_RDONLY)) < 0) {
+		return LIBMPQ_ERROR_OPEN;
+	}
+
+	/* check size and map manifest. */
+	if (fstat(fd, &sb) < 0 || sb.st_size < (off_t)sizeof(struct mpq_manifest__header_s)) {
+		close(fd);
+		return LIBMPQ_ERROR_FORMAT;
+	}
+	if ((data = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED) {
+		close(fd);
+		return LIBMPQ_ERROR_READ;
+	}
+
+	/* mapping stays valid after close. */
+	close(fd);
+
+	/* check header, that all sections are aligned as written and inside the file. */
+	header = data;
+	if (memcmp(header->magic, MPQ_MANIFEST_MAGIC, 4) != 0 ||
+	    header->version != MPQ_MANIFEST_VERSION ||
+	    header->size != (uint64_t)sb.st_size ||
+	    header->archive_offset != MPQ_MANIFEST_ALIGN(header->archive_offset) ||
+	    header->entry_offset != MPQ_MANIFEST_ALIGN(header->entry_offset) ||
+	    header->name_offset != MPQ_MANIFEST_ALIGN(header->name_offset) ||
+	    header->bucket_offset != MPQ_MANIFEST_ALIGN(header->bucket_offset) ||
+	    header->string_offset != MPQ_MANIFEST_ALIGN(header->string_offset) ||
+	    header->archive_offset < sizeof(struct mpq_manifest__header_s) ||
+	    header->archive_offset + (uint64_t)header->archives * sizeof(struct mpq_manifest__archive_s) > header->entry_offset ||
+	    header->entry_offset + (uint64_t)header->entries * sizeof(struct mpq_manifest__entry_s) > header->name_offset ||
+	    header->name_offset + (uint64_t)header->names * sizeof(struct mpq_manifest__name_s) > header->bucket_offset ||
+	    header->bits < 1 || header->bits > 31 ||
+	    header->bucket_offset + (((uint64_t)1 << header->bits) + 1) * sizeof(uint32_t) > header->string_offset ||
+	    header->string_offset > header->size ||
+	    (header->string_offset < header->size && ((char *)data)[header->size - 1] != '\0')) {
+		munmap(data, sb.st_size);
+		return LIBMPQ_ERROR_FORMAT;
+	}
+
+	/* allocate manifest. */
+	if ((*manifest = calloc(1, sizeof(mpq_manifest_s))) == NULL) {
+		munmap(data, sb.st_size);
+		return LIBMPQ_ERROR_MALLOC;
+	}
+
+	/* point to sections. */
+	(*manifest)->data    = data;
+	(*manifest)->size    = sb.st_size;
+	(*manifest)->header  = header;
+	(*manifest)->archive = (struct mpq_manifest__archive_s *)((unsigned char *)data + header->archive_offset);
+	(*manifest)->entry   = (struct mpq_manifest__entry_s *)((unsigned char *)data + header->entry_offset);
+	(*manifest)->name    = (struct mpq_manifest__name_s *)((unsigned char *)data + header->name_offset);
+	(*manifest)->bucket  = (uint32_t *)((unsigned char *)data + header->bucket_offset);
+	(*manifest)->string  = (char *)data + header->string_offset;
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function unmaps and frees a manifest. */
+int mpq_manifest__close(mpq_manifest_s *manifest) {
+
+	/* unmap manifest. */
+	if (munmap(manifest->data, manifest->size) < 0) {
+		free(manifest);
+		return LIBMPQ_ERROR_CLOSE;
+	}
+
+	/* free manifest. */
+	free(manifest);
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function searches an archive by the file name it was written with. */
+int mpq_manifest__archive(mpq_manifest_s *manifest, const char *mpq_filename, uint32_t *archive) {
+
+	/* some common variables. */
+	uint64_t strings = manifest->header->size - manifest->header->string_offset;
+	uint32_t i;
+
+	/* loop through all archives. */
+	for (i = 0; i < manifest->header->archives; i++) {
+		if (manifest->archive[i].name < strings && strcmp(manifest->string + manifest->archive[i].name, mpq_filename) == 0) {
+			*archive = i;
+			return 0;
+		}
+	}
+
+	/* archive was not found. */
+	return LIBMPQ_ERROR_EXIST;
+}
+
+/* this function returns the entry of a file number in an archive. */
+int mpq_manifest__entry(mpq_manifest_s *manifest, uint32_t archive, uint32_t file_number, struct mpq_manifest__entry_s **entry) {
+
+	/* check if archive and file number are in range. */
+	if (archive >= manifest->header->archives ||
+	    file_number >= manifest->archive[archive].files ||
+	    (uint64_t)manifest->archive[archive].first + file_number >= manifest->header->entries) {
+		return LIBMPQ_ERROR_EXIST;
+	}
+
+	/* entries are stored in archive and file number order. */
+	*entry = &manifest->entry[manifest->archive[archive].first + file_number];
+
+	/* if no error was found, return zero. */
+	return 0;
+}
+
+/* this function searches a file name, next is zero for the first match and is updated for the following ones. */
+int mpq_manifest__lookup(mpq_manifest_s *manifest, const char *filename, uint32_t *next, struct mpq_manifest__entry_s **entry) {
+
+	/* some common variables. */
+	uint64_t strings = manifest->header->size - manifest->header->string_offset;
+	uint64_t hash    = mpq_manifest__hash(filename);
+	uint32_t bucket  = hash >> (64 - manifest->header->bits);
+	uint32_t first   = manifest->bucket[bucket];
+	uint32_t last    = manifest->bucket[bucket + 1];
+	uint32_t i;
+
+	/* never leave the name table, even if buckets are corrupt. */
+	if (last > manifest->header->names) {
+		last = manifest->header->names;
+	}
+
+	/* loop through names of the bucket, they are sorted by hash. */
+	for (i = *next > first ? *next : first; i < last && manifest->name[i].hash <= hash; i++) {
+
+		/* skip other names and names pointing outside the manifest. */
+		if (manifest->name[i].hash != hash ||
+		    manifest->name[i].entry >= manifest->header->entries ||
+		    manifest->name[i].name >= strings ||
+		    !mpq_manifest__name_equal(manifest->string + manifest->name[i].name, filename)) {
+			continue;
+		}
+
+		/* name was found, continue after it next time. */
+		*entry = &manifest->entry[manifest->name[i].entry];
+		*next  = i + 1;
+
+		/* if no error was found, return zero. */
+		return 0;
+	}
+
+	/* no more files with this name. */
+	return LIBMPQ_ERROR_EXIST;
+}
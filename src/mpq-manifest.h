@@ -0,0 +1,125 @@
+/*
+ *  mpq-manifest.h -- binary manifest of archive contents for fast lookups.
+ *
+ *  Copyright (c) 2003-2008 Maik Broemme <mbroemme@plusserver.de>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MPQ_MANIFEST_H
+#define _MPQ_MANIFEST_H
+
+/* generic includes. */
+#include <stdint.h>
+#include <sys/types.h>
+
+/* define manifest signature and format version. */
+#define MPQ_MANIFEST_MAGIC		"MPQX"
+#define MPQ_MANIFEST_VERSION		1
+
+/* define alignment of manifest sections. */
+#define MPQ_MANIFEST_ALIGN(x)		(((x) + 7) & ~((uint64_t)7))
+
+/* define entry flags. */
+#define MPQ_MANIFEST_COMPRESSED		0x00000001
+#define MPQ_MANIFEST_IMPLODED		0x00000002
+#define MPQ_MANIFEST_ENCRYPTED		0x00000004
+
+/*
+ * the manifest is written in host byte order and laid out as follows,
+ * every section starts 8 byte aligned so the file can be used directly
+ * after mmap():
+ *
+ *   header		struct mpq_manifest__header_s
+ *   archives		archives times struct mpq_manifest__archive_s
+ *   entries		entries times struct mpq_manifest__entry_s
+ *   names		names times struct mpq_manifest__name_s
+ *   buckets		(1 << bits) + 1 times uint32_t
+ *   strings		zero terminated archive and file names
+ *
+ * entries are stored in archive order and file number order inside an
+ * archive, so an entry is found directly from archive and file number.
+ * names are taken from the (listfile) of every archive and sorted by the
+ * hash of the upper case file name with '/' as '\\'. bucket i holds the
+ * first name whose hash has i as its top bits, so a file name is found by
+ * comparing only the few names between two buckets. files not listed in
+ * any (listfile) have no name and are found by file number only.
+ */
+
+/* manifest header. */
+struct mpq_manifest__header_s {
+	char		magic[4];	/* manifest signature. */
+	uint32_t	version;	/* manifest format version. */
+	uint32_t	archives;	/* number of archives. */
+	uint32_t	entries;	/* number of files in all archives. */
+	uint32_t	names;		/* number of file names. */
+	uint32_t	bits;		/* number of hash bits used for buckets. */
+	uint64_t	archive_offset;	/* offset of archive table. */
+	uint64_t	entry_offset;	/* offset of entry table. */
+	uint64_t	name_offset;	/* offset of name table. */
+	uint64_t	bucket_offset;	/* offset of bucket table. */
+	uint64_t	string_offset;	/* offset of string table. */
+	uint64_t	size;		/* size of whole manifest. */
+};
+
+/* manifest archive. */
+struct mpq_manifest__archive_s {
+	uint64_t	offset;		/* offset of archive in file. */
+	uint32_t	name;		/* file name, offset in string table. */
+	uint32_t	version;	/* archive version. */
+	uint32_t	files;		/* number of files in archive. */
+	uint32_t	first;		/* entry of first file in archive. */
+};
+
+/* manifest entry. */
+struct mpq_manifest__entry_s {
+	uint64_t	offset;		/* absolute offset of file data. */
+	uint64_t	size_packed;	/* packed size of file. */
+	uint64_t	size_unpacked;	/* unpacked size of file. */
+	uint32_t	flags;		/* compression and encryption flags. */
+	uint32_t	archive;	/* archive holding the file. */
+};
+
+/* manifest name. */
+struct mpq_manifest__name_s {
+	uint64_t	hash;		/* hash of file name. */
+	uint32_t	entry;		/* entry of file. */
+	uint32_t	name;		/* file name, offset in string table. */
+};
+
+/* opened manifest. */
+typedef struct {
+	unsigned char	*data;		/* mapped manifest. */
+	size_t		size;		/* size of mapped manifest. */
+	struct mpq_manifest__header_s	*header;
+	struct mpq_manifest__archive_s	*archive;
+	struct mpq_manifest__entry_s	*entry;
+	struct mpq_manifest__name_s	*name;
+	uint32_t	*bucket;	/* first name of every bucket. */
+	char		*string;	/* string table. */
+} mpq_manifest_s;
+
+/* manifest reading functions, no archive is opened and libmpq is not
+ * needed. they return zero or a negative LIBMPQ_ERROR_* code. */
+extern int mpq_manifest__open(mpq_manifest_s **manifest, const char *manifest_filename);
+extern int mpq_manifest__close(mpq_manifest_s *manifest);
+extern int mpq_manifest__archive(mpq_manifest_s *manifest, const char *mpq_filename, uint32_t *archive);
+extern int mpq_manifest__entry(mpq_manifest_s *manifest, uint32_t archive, uint32_t file_number, struct mpq_manifest__entry_s **entry);
+extern int mpq_manifest__lookup(mpq_manifest_s *manifest, const char *filename, uint32_t *next, struct mpq_manifest__entry_s **entry);
+
+/* file name hash, used for the name table. */
+extern uint64_t mpq_manifest__hash(const char *filename);
+
+#endif						/* _MPQ_MANIFEST_H */
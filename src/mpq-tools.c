@@ -0,0 +1,63 @@
+/*
+ *  mpq-tools.c -- functions shared by all mpq-tools utilities.
+ *
+ *  Copyright (c) 2003-2008 Maik Broemme <mbroemme@plusserver.de>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+/* mpq-tools configuration includes. */
+#include "config.h"
+
+/* generic includes. */
+#include <stdio.h>
+
+/* mpq-tools includes. */
+#include "mpq-tools.h"
+
+/* XXX: this is a hack to make mpq-tools work until proper listfile
+ * support is added, it returns a synthetic name for every file. */
+int32_t mpq_tools__file_name(mpq_archive_s *mpq_archive, uint32_t file_number, char *filename, size_t filename_size) {
+
+	int32_t result = 0;
+
+	if ((result = snprintf(filename, filename_size, "file%06i.xxx", file_number)) < 0) {
+		return LIBMPQ_ERROR_FORMAT;
+	}
+	return result;
+}
+
+/* this function returns the offset of the file data in the archive file.
+ * libmpq returns block offsets relative to the archive header, which is
+ * not at the start of the file for archives embedded in executables or
+ * installers, so every user of raw file offsets has to go through here. */
+int32_t mpq_tools__file_offset(mpq_archive_s *mpq_archive, uint32_t file_number, off_t *offset) {
+
+	/* some common variables. */
+	off_t archive_offset = 0;
+	int32_t result;
+
+	/* fetch offset of archive and of file in archive. */
+	if ((result = libmpq__archive_offset(mpq_archive, &archive_offset)) < 0 ||
+	    (result = libmpq__file_offset(mpq_archive, file_number, offset)) < 0) {
+		return result;
+	}
+
+	/* make offset absolute. */
+	*offset += archive_offset;
+
+	/* if no error was found, return zero. */
+	return 0;
+}
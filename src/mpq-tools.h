@@ -0,0 +1,38 @@
+/*
+ *  mpq-tools.h -- functions shared by all mpq-tools utilities.
+ *
+ *  Copyright (c) 2003-2008 Maik Broemme <mbroemme@plusserver.de>
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ */
+
+#ifndef _MPQ_TOOLS_H
+#define _MPQ_TOOLS_H
+
+/* generic includes. */
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+/* libmpq includes. */
+#include <mpq.h>
+
+/* file name functions. */
+extern int32_t mpq_tools__file_name(mpq_archive_s *mpq_archive, uint32_t file_number, char *filename, size_t filename_size);
+
+/* file offset functions. */
+extern int32_t mpq_tools__file_offset(mpq_archive_s *mpq_archive, uint32_t file_number, off_t *offset);
+
+#endif						/* _MPQ_TOOLS_H */